@@ -2,11 +2,13 @@
 #define CHIP8_HPP
 #include <string>
 #include <stdint.h>
+#include <stddef.h>
 #include <vector>
 
 struct SideEffects
 {
     bool clear;
+    bool fault;
     bool wait;
     int wait_reg;
     int draw_x;
@@ -14,12 +16,40 @@ struct SideEffects
     int draw_n;
 };
 
+// Events that run() and runFrames() report, and may be asked to stop on.
+// EVENT_WAIT (Fx0A) and EVENT_FAULT (unsupported opcode) always stop a run.
+enum RunEvent
+{
+    EVENT_WAIT  = 1 << 0,
+    EVENT_CLEAR = 1 << 1,
+    EVENT_DRAW  = 1 << 2,
+    EVENT_SOUND = 1 << 3,
+    EVENT_FAULT = 1 << 4,
+};
+
+// Side effects aggregated over a whole run
+struct RunEffects
+{
+    int cycles;
+    int frames;
+    int events;
+    bool dirty;
+    bool sound_on;
+    bool sound_off;
+    bool wait;
+    int wait_reg;
+};
+
 struct Chip8
 {
 public:
-    Chip8();
-    void load(std::string rompath);
+    Chip8(uint32_t seed = 1);
+    bool load(std::string rompath);
+    bool load(const uint8_t* rom, size_t size);
     SideEffects cycle();
+    RunEffects run(int cycles, int stop_events = EVENT_WAIT);
+    RunEffects runFrames(int frames, int cycles_per_frame, int stop_events = EVENT_WAIT);
+    void tickTimers();
     void dumpState();
 
     uint8_t regs[16];
@@ -30,6 +60,8 @@ public:
     uint16_t pc;
     uint16_t sp;
     uint16_t keys;
+    uint32_t rng;
+    int frame_cycles;
     bool screen[64*32];
 };
 #endif
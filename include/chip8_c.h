@@ -0,0 +1,67 @@
+#ifndef CHIP8_C_H
+#define CHIP8_C_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Chip8 Chip8;
+
+#define CHIP8_EVENT_WAIT  (1 << 0)
+#define CHIP8_EVENT_CLEAR (1 << 1)
+#define CHIP8_EVENT_DRAW  (1 << 2)
+#define CHIP8_EVENT_SOUND (1 << 3)
+#define CHIP8_EVENT_FAULT (1 << 4)
+
+typedef struct chip8_result
+{
+    int cycles;
+    int frames;
+    int events;
+    bool dirty;
+    bool sound_on;
+    bool sound_off;
+    bool wait;
+    int wait_reg;
+} chip8_result;
+
+// Pointers straight into the machine, valid until chip8_destroy()
+typedef struct chip8_state
+{
+    uint8_t* regs;
+    uint16_t* ir;
+    uint8_t* memory;
+    size_t memory_size;
+    uint8_t* dt;
+    uint8_t* st;
+    uint16_t* pc;
+    uint16_t* sp;
+    uint16_t* keys;
+    uint32_t* rng;
+    int* frame_cycles;
+    bool* screen;
+} chip8_state;
+
+Chip8* chip8_create(void);
+void chip8_destroy(Chip8* chip8);
+// Seeds the generator behind Cxkk, which starts at 1
+void chip8_seed(Chip8* chip8, uint32_t seed);
+// Both return 0 on success, -1 if the ROM is missing or does not fit
+int chip8_load_file(Chip8* chip8, const char* rompath);
+int chip8_load_rom(Chip8* chip8, const uint8_t* rom, size_t size);
+
+// Stops after the given count, or after the first instruction raising one of
+// stop_events. Fx0A always stops: store the key in regs[wait_reg] and resume.
+// An unsupported opcode always stops with CHIP8_EVENT_FAULT, pc left on it.
+chip8_result chip8_run(Chip8* chip8, int cycles, int stop_events);
+chip8_result chip8_run_frames(Chip8* chip8, int frames, int cycles_per_frame, int stop_events);
+
+chip8_state chip8_get_state(Chip8* chip8);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
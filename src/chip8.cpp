@@ -3,7 +3,7 @@
 #include <stdio.h>
 #include <assert.h>
 
-Chip8::Chip8()
+Chip8::Chip8(uint32_t seed)
 {
     memset(regs, 0, sizeof(regs));
     memset(memory, 0, sizeof(memory));
@@ -122,22 +122,34 @@ Chip8::Chip8()
     memory[79] = 0x80;
 
     keys = 0;
+    ir = 0;
     dt = 0;
+    st = 0;
+    rng = seed;
+    frame_cycles = 0;
     pc = 0x200;
     sp = 80;
 }
 
-void Chip8::load(std::string rompath)
+bool Chip8::load(std::string rompath)
 {
     FILE* fp = fopen(rompath.c_str(), "r");
+    if (!fp) return false;
     fseek(fp, 0, SEEK_END);
-    size_t size = ftell(fp);
+    long size = ftell(fp);
     fseek(fp, 0, SEEK_SET);
 
-    if (fread(&memory[0x200], 1, size, fp) != size) {
-        perror("fread: ");
-        exit(1);
-    }
+    bool ok = size >= 0 && (size_t)size <= sizeof(memory) - 0x200
+        && fread(&memory[0x200], 1, size, fp) == (size_t)size;
+    fclose(fp);
+    return ok;
+}
+
+bool Chip8::load(const uint8_t* rom, size_t size)
+{
+    if (size > sizeof(memory) - 0x200) return false;
+    memcpy(&memory[0x200], rom, size);
+    return true;
 }
 
 SideEffects Chip8::cycle()
@@ -147,6 +159,7 @@ SideEffects Chip8::cycle()
 
     SideEffects eff;
     eff.clear = false;
+    eff.fault = false;
     eff.wait = false;
     eff.draw_n = 0;
 
@@ -156,9 +169,9 @@ SideEffects Chip8::cycle()
     } else if (instr == 0x00EE) { // RET
         sp -= 2;
         pc = (memory[sp] << 8) | memory[sp+1];
-    } else if (instr >> 12 == 0) {
-        fprintf(stderr, "Machine language subroutine are not supported\n");
-        exit(1);
+    } else if (instr >> 12 == 0) { // SYS, not supported
+        pc -= 2;
+        eff.fault = true;
     } else if (instr >> 12 == 1) { // JP
         pc = instr & 0x0FFF;
     } else if (instr >> 12 == 2) { // CALL
@@ -237,7 +250,9 @@ SideEffects Chip8::cycle()
     } else if (instr >> 12 == 0xc) { // RND
         uint8_t kk = instr & 0x00FF;
         uint8_t x = (instr >> 8) & 0xF;
-        regs[x] = rand() & kk;
+        // per-machine generator, so that machines run reproducibly side by side
+        rng = rng * 1103515245 + 12345;
+        regs[x] = (rng >> 16) & kk;
     } else if (instr >> 12 == 0xd) { // DRW
         uint8_t n = instr & 0x000F;
         uint8_t y = (instr >> 4) & 0xF;
@@ -303,8 +318,8 @@ SideEffects Chip8::cycle()
         }
         ir += x + 1;
     } else {
-        fprintf(stderr, "Unknown instruction: %x\n", instr);
-        exit(1);
+        pc -= 2;
+        eff.fault = true;
     }
 
     // dumpState();
@@ -312,6 +327,92 @@ SideEffects Chip8::cycle()
     return eff;
 }
 
+RunEffects Chip8::run(int cycles, int stop_events)
+{
+    RunEffects res;
+    memset(&res, 0, sizeof(res));
+    stop_events |= EVENT_WAIT | EVENT_FAULT;
+
+    while (res.cycles < cycles)
+    {
+        bool sound = st > 0;
+        SideEffects eff = cycle();
+        if (eff.fault) {
+            res.events |= EVENT_FAULT;
+            break;
+        }
+        res.cycles++;
+
+        int events = 0;
+        if (eff.clear) events |= EVENT_CLEAR;
+        if (eff.draw_n > 0) events |= EVENT_DRAW;
+        if (!sound && st > 0) {
+            events |= EVENT_SOUND;
+            res.sound_on = true;
+        } else if (sound && st == 0) {
+            events |= EVENT_SOUND;
+            res.sound_off = true;
+        }
+        if (eff.wait) {
+            events |= EVENT_WAIT;
+            res.wait = true;
+            res.wait_reg = eff.wait_reg;
+        }
+
+        res.events |= events;
+        if (events & stop_events) break;
+    }
+
+    res.dirty = res.events & (EVENT_CLEAR | EVENT_DRAW);
+    return res;
+}
+
+// Runs cycles_per_frame instructions then ticks the timers, once per frame.
+// The position within the frame is kept in frame_cycles, so a run stopped by
+// an event finishes its frame on the next call and ticks on time.
+RunEffects Chip8::runFrames(int frames, int cycles_per_frame, int stop_events)
+{
+    RunEffects res;
+    memset(&res, 0, sizeof(res));
+    stop_events |= EVENT_WAIT | EVENT_FAULT;
+
+    while (res.frames < frames)
+    {
+        RunEffects fr = run(cycles_per_frame - frame_cycles, stop_events);
+        frame_cycles += fr.cycles;
+        res.cycles += fr.cycles;
+        res.events |= fr.events;
+        res.dirty |= fr.dirty;
+        res.sound_on |= fr.sound_on;
+        res.sound_off |= fr.sound_off;
+        if (fr.wait) {
+            res.wait = true;
+            res.wait_reg = fr.wait_reg;
+        }
+
+        if (frame_cycles >= cycles_per_frame) {
+            bool sound = st > 0;
+            tickTimers();
+            frame_cycles = 0;
+            res.frames++;
+            if (sound && st == 0) {
+                res.events |= EVENT_SOUND;
+                res.sound_off = true;
+                fr.events |= EVENT_SOUND;
+            }
+        }
+        if (fr.events & stop_events) break;
+    }
+
+    return res;
+}
+
+void Chip8::tickTimers()
+{
+    if (dt > 0) dt--;
+    if (st > 0) st--;
+}
+
 void Chip8::dumpState()
 {
     for (int i = 0; i < 16; i++)
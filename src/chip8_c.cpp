@@ -0,0 +1,75 @@
+#include "chip8_c.h"
+#include "chip8.hpp"
+
+static_assert(CHIP8_EVENT_WAIT == EVENT_WAIT, "event mismatch");
+static_assert(CHIP8_EVENT_CLEAR == EVENT_CLEAR, "event mismatch");
+static_assert(CHIP8_EVENT_DRAW == EVENT_DRAW, "event mismatch");
+static_assert(CHIP8_EVENT_SOUND == EVENT_SOUND, "event mismatch");
+static_assert(CHIP8_EVENT_FAULT == EVENT_FAULT, "event mismatch");
+
+static chip8_result toResult(const RunEffects& eff)
+{
+    chip8_result res;
+    res.cycles = eff.cycles;
+    res.frames = eff.frames;
+    res.events = eff.events;
+    res.dirty = eff.dirty;
+    res.sound_on = eff.sound_on;
+    res.sound_off = eff.sound_off;
+    res.wait = eff.wait;
+    res.wait_reg = eff.wait_reg;
+    return res;
+}
+
+Chip8* chip8_create(void)
+{
+    return new Chip8();
+}
+
+void chip8_destroy(Chip8* chip8)
+{
+    delete chip8;
+}
+
+void chip8_seed(Chip8* chip8, uint32_t seed)
+{
+    chip8->rng = seed;
+}
+
+int chip8_load_file(Chip8* chip8, const char* rompath)
+{
+    return chip8->load(std::string(rompath)) ? 0 : -1;
+}
+
+int chip8_load_rom(Chip8* chip8, const uint8_t* rom, size_t size)
+{
+    return chip8->load(rom, size) ? 0 : -1;
+}
+
+chip8_result chip8_run(Chip8* chip8, int cycles, int stop_events)
+{
+    return toResult(chip8->run(cycles, stop_events));
+}
+
+chip8_result chip8_run_frames(Chip8* chip8, int frames, int cycles_per_frame, int stop_events)
+{
+    return toResult(chip8->runFrames(frames, cycles_per_frame, stop_events));
+}
+
+chip8_state chip8_get_state(Chip8* chip8)
+{
+    chip8_state state;
+    state.regs = chip8->regs;
+    state.ir = &chip8->ir;
+    state.memory = chip8->memory;
+    state.memory_size = sizeof(chip8->memory);
+    state.dt = &chip8->dt;
+    state.st = &chip8->st;
+    state.pc = &chip8->pc;
+    state.sp = &chip8->sp;
+    state.keys = &chip8->keys;
+    state.rng = &chip8->rng;
+    state.frame_cycles = &chip8->frame_cycles;
+    state.screen = chip8->screen;
+    return state;
+}
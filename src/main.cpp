@@ -2,6 +2,7 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 #include "chip8.hpp"
+#include <time.h>
 #include "imgui.h"
 #include "imgui_impl_sdl.h"
 #include "imgui_impl_opengl2.h"
@@ -163,8 +164,11 @@ int main(int argc, char** argv)
 
     SDL_Event e;
 
-    Chip8 chip8;
-    chip8.load(std::string(argv[1]));
+    Chip8 chip8((uint32_t)time(NULL));
+    if (!chip8.load(std::string(argv[1]))) {
+        fprintf(stderr, "Could not load %s\n", argv[1]);
+        return 1;
+    }
 
     SDL_AudioSpec want, have;
     memset(&want, 0, sizeof(want));
@@ -192,6 +196,7 @@ int main(int argc, char** argv)
     int wait_reg;
     bool step_go = false;
     bool stepmode = true;
+    int status = 0;
 
     while (true) {
 
@@ -226,6 +231,17 @@ int main(int argc, char** argv)
             last_cycle = current;
             SideEffects eff = chip8.cycle();
 
+            if (eff.fault) {
+                uint16_t instr = (chip8.memory[chip8.pc] << 8) | chip8.memory[chip8.pc+1];
+                if (instr >> 12 == 0) {
+                    fprintf(stderr, "Machine language subroutine are not supported\n");
+                } else {
+                    fprintf(stderr, "Unknown instruction: %x\n", instr);
+                }
+                status = 1;
+                break;
+            }
+
             if (eff.clear) {
                 memset(pixels, 0, sizeof(pixels));
                 glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 64, 32, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
@@ -280,8 +296,7 @@ int main(int argc, char** argv)
         }
 
         if (current - last_frame >= 17) {
-            if (chip8.dt > 0) chip8.dt--;
-            if (chip8.st > 0) chip8.st--;
+            chip8.tickTimers();
             last_frame = current;
 
 			ImGui_ImplOpenGL2_NewFrame();
@@ -320,5 +335,5 @@ int main(int argc, char** argv)
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
     SDL_Quit();
-    return 0;
+    return status;
 }
@@ -0,0 +1,673 @@
+#include "chip8.hpp"
+#include "chip8_c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs up to `cycles` instructions and ticks the timers each time
+// Chip8::frame_cycles reaches cycles_per_frame, like Chip8::runFrames().
+// Stops after Fx0A or on an unsupported opcode.
+typedef RunEffects (*Engine)(Chip8& chip8, int cycles, int cycles_per_frame);
+
+struct EngineEntry
+{
+    const char* name;
+    Engine engine;
+};
+
+struct InputEvent
+{
+    long cycle;
+    uint16_t keys;
+};
+
+struct Options
+{
+    Engine candidate;
+    long instructions;
+    long interval;
+    int cycles_per_frame;
+};
+
+// Distinct PCs the reference executes from instruction `from` on
+struct Coverage
+{
+    long from;
+    std::vector<bool> seen;
+    int distinct;
+};
+
+enum Step
+{
+    STEP_OK,
+    STEP_DIVERGED,
+    STEP_FAULT,
+};
+
+struct Divergence
+{
+    bool exact;
+    bool effects;
+    long from;
+    long cycle;
+    uint16_t pc;
+    uint16_t instr;
+    Chip8 ref;
+    Chip8 cand;
+};
+
+// Chip8::cycle() one instruction at a time, ticking every frame and
+// aggregating the same effects that Chip8::runFrames() reports
+static RunEffects stepReference(Chip8& chip8, int cycles, int cycles_per_frame, long cycle, Coverage* cov)
+{
+    RunEffects res;
+    memset(&res, 0, sizeof(res));
+    while (res.cycles < cycles)
+    {
+        if (cov && cycle + res.cycles >= cov->from && !cov->seen[chip8.pc & 0xFFF]) {
+            cov->seen[chip8.pc & 0xFFF] = true;
+            cov->distinct++;
+        }
+
+        bool sound = chip8.st > 0;
+        SideEffects eff = chip8.cycle();
+        if (eff.fault) {
+            res.events |= EVENT_FAULT;
+            break;
+        }
+        res.cycles++;
+
+        if (eff.clear) res.events |= EVENT_CLEAR;
+        if (eff.draw_n > 0) res.events |= EVENT_DRAW;
+        if (!sound && chip8.st > 0) {
+            res.events |= EVENT_SOUND;
+            res.sound_on = true;
+        } else if (sound && chip8.st == 0) {
+            res.events |= EVENT_SOUND;
+            res.sound_off = true;
+        }
+
+        if (++chip8.frame_cycles >= cycles_per_frame) {
+            sound = chip8.st > 0;
+            chip8.tickTimers();
+            chip8.frame_cycles = 0;
+            res.frames++;
+            if (sound && chip8.st == 0) {
+                res.events |= EVENT_SOUND;
+                res.sound_off = true;
+            }
+        }
+
+        if (eff.wait) {
+            res.events |= EVENT_WAIT;
+            res.wait = true;
+            res.wait_reg = eff.wait_reg;
+            break;
+        }
+    }
+    res.dirty = res.events & (EVENT_CLEAR | EVENT_DRAW);
+    return res;
+}
+
+static RunEffects referenceEngine(Chip8& chip8, int cycles, int cycles_per_frame)
+{
+    return stepReference(chip8, cycles, cycles_per_frame, 0, NULL);
+}
+
+static void addEffects(RunEffects& res, const chip8_result& r)
+{
+    res.cycles += r.cycles;
+    res.frames += r.frames;
+    res.events |= r.events;
+    res.dirty |= r.dirty;
+    res.sound_on |= r.sound_on;
+    res.sound_off |= r.sound_off;
+    if (r.wait) {
+        res.wait = true;
+        res.wait_reg = r.wait_reg;
+    }
+}
+
+// What an embedder does through the C API: whole frames with
+// chip8_run_frames(), then the rest of the budget with chip8_run()
+static RunEffects framesEngine(Chip8& chip8, int cycles, int cycles_per_frame)
+{
+    RunEffects res;
+    memset(&res, 0, sizeof(res));
+    chip8_state state = chip8_get_state(&chip8);
+
+    int frames = (*state.frame_cycles + cycles) / cycles_per_frame;
+    if (frames > 0) {
+        addEffects(res, chip8_run_frames(&chip8, frames, cycles_per_frame, 0));
+        if (res.events & (EVENT_WAIT | EVENT_FAULT)) return res;
+    }
+
+    chip8_result r = chip8_run(&chip8, cycles - res.cycles, 0);
+    *state.frame_cycles += r.cycles;
+    addEffects(res, r);
+    return res;
+}
+
+static const EngineEntry engines[] = {
+    { "reference", referenceEngine },
+    { "frames", framesEngine },
+};
+
+// FNV-1a
+static uint32_t hash(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool sameState(const Chip8& a, const Chip8& b)
+{
+    return memcmp(a.regs, b.regs, sizeof(a.regs)) == 0
+        && a.ir == b.ir
+        && a.pc == b.pc
+        && a.sp == b.sp
+        && a.dt == b.dt
+        && a.st == b.st
+        && a.rng == b.rng
+        && a.frame_cycles == b.frame_cycles
+        && memcmp(a.memory, b.memory, sizeof(a.memory)) == 0
+        && memcmp(a.screen, b.screen, sizeof(a.screen)) == 0;
+}
+
+static bool sameEffects(const RunEffects& a, const RunEffects& b)
+{
+    return a.cycles == b.cycles
+        && a.frames == b.frames
+        && a.events == b.events
+        && a.dirty == b.dirty
+        && a.sound_on == b.sound_on
+        && a.sound_off == b.sound_off
+        && a.wait == b.wait
+        && (!a.wait || a.wait_reg == b.wait_reg);
+}
+
+static void printState(const char* name, const Chip8& chip8)
+{
+    printf("%-9s", name);
+    for (int i = 0; i <= 0xf; i++)
+    {
+        printf(" V%x=%02x", i, chip8.regs[i]);
+    }
+    printf("\n          I=%03x PC=%03x SP=%03x DT=%02x ST=%02x mem=%08x screen=%08x\n",
+           chip8.ir, chip8.pc, chip8.sp, chip8.dt, chip8.st,
+           hash(chip8.memory, sizeof(chip8.memory)), hash(chip8.screen, sizeof(chip8.screen)));
+}
+
+// Advances both machines to `target` cycles in as few engine calls as input
+// changes and Fx0A answers allow, which land on the same cycle for both.
+static Step advance(Chip8& ref, Chip8& cand, const Options& opts, const std::vector<InputEvent>& input,
+                    Coverage* cov, long& cycle, size_t& next_input, long target)
+{
+    while (cycle < target)
+    {
+        while (next_input < input.size() && input[next_input].cycle <= cycle) {
+            ref.keys = input[next_input].keys;
+            cand.keys = input[next_input].keys;
+            next_input++;
+        }
+
+        long stop = target;
+        if (next_input < input.size() && input[next_input].cycle < stop) stop = input[next_input].cycle;
+
+        RunEffects r = stepReference(ref, stop - cycle, opts.cycles_per_frame, cycle, cov);
+        RunEffects c = opts.candidate(cand, stop - cycle, opts.cycles_per_frame);
+        if (!sameEffects(r, c)) return STEP_DIVERGED;
+        cycle += r.cycles;
+        if (r.events & EVENT_FAULT) return STEP_FAULT;
+
+        // Fx0A is answered with the lowest key held, or key 0 if none is
+        if (r.wait) {
+            int key = 0;
+            while (key < 15 && !((ref.keys >> key) & 1)) key++;
+            if (!((ref.keys >> key) & 1)) key = 0;
+            ref.regs[r.wait_reg] = key;
+            cand.regs[c.wait_reg] = key;
+        }
+    }
+    return STEP_OK;
+}
+
+// Compares the machines every `interval` instructions. On a mismatch the
+// interval is replayed one instruction at a time to find the first bad one.
+// Both machines hitting the same unsupported opcode ends the run early.
+static Step verify(const Chip8& start, const Options& opts, const std::vector<InputEvent>& input,
+                   Coverage* cov, Divergence* div)
+{
+    Chip8 ref = start;
+    Chip8 cand = start;
+    long cycle = 0;
+    size_t next_input = 0;
+
+    while (cycle < opts.instructions)
+    {
+        Chip8 ref_ck = ref;
+        Chip8 cand_ck = cand;
+        long cycle_ck = cycle;
+        size_t input_ck = next_input;
+
+        long target = cycle + opts.interval;
+        if (target > opts.instructions) target = opts.instructions;
+        Step step = advance(ref, cand, opts, input, cov, cycle, next_input, target);
+        if (step != STEP_DIVERGED && sameState(ref, cand)) {
+            if (step == STEP_OK) continue;
+            div->cycle = cycle;
+            div->pc = ref.pc;
+            div->instr = (ref.memory[ref.pc] << 8) | ref.memory[ref.pc+1];
+            return STEP_FAULT;
+        }
+
+        Chip8 ref_bad = ref;
+        Chip8 cand_bad = cand;
+        ref = ref_ck;
+        cand = cand_ck;
+        cycle = cycle_ck;
+        next_input = input_ck;
+        div->from = cycle_ck;
+        div->exact = false;
+        div->effects = false;
+        while (cycle < target)
+        {
+            div->cycle = cycle;
+            div->pc = ref.pc;
+            div->instr = (ref.memory[ref.pc] << 8) | ref.memory[ref.pc+1];
+            step = advance(ref, cand, opts, input, NULL, cycle, next_input, cycle + 1);
+            if (step == STEP_DIVERGED || !sameState(ref, cand)) {
+                div->exact = true;
+                div->effects = step == STEP_DIVERGED;
+                break;
+            }
+            if (step == STEP_FAULT) break;
+        }
+
+        // a candidate that only diverges when batched is reported for the whole interval
+        div->cycle = div->exact ? div->cycle : target;
+        div->ref = div->exact ? ref : ref_bad;
+        div->cand = div->exact ? cand : cand_bad;
+        return STEP_DIVERGED;
+    }
+    return STEP_OK;
+}
+
+static void printDivergence(const Divergence& div)
+{
+    if (div.exact) {
+        printf("diverged at instruction %ld (pc=%03x, opcode=%04x)%s\n", div.cycle, div.pc, div.instr,
+               div.effects ? ", reported side effects differ" : "");
+    } else {
+        printf("diverged between instructions %ld and %ld, not when single-stepped\n", div.from, div.cycle);
+    }
+    printState("reference", div.ref);
+    printState("candidate", div.cand);
+}
+
+struct Random
+{
+    uint32_t state;
+
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    int below(int n)
+    {
+        return next() % n;
+    }
+};
+
+#define CODE_START 0x200
+#define CODE_END   0xA00
+#define SUB_START  0xA00
+#define SUB_END    0xC00
+#define DATA_START 0xC00
+#define DATA_END   0xF00
+
+// Distinct PCs a random ROM has to run in the second half of its run
+#define MIN_COVERAGE 64
+#define MAX_RESEEDS  8
+
+// Any opcode that only touches registers and timers
+static uint16_t randomAlu(Random& rnd)
+{
+    uint16_t x = rnd.below(16) << 8;
+    uint16_t y = rnd.below(16) << 4;
+    uint16_t kk = rnd.below(256);
+    static const uint8_t alu8[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+    static const uint8_t aluF[] = { 0x07, 0x15, 0x18 };
+    switch (rnd.below(5)) {
+        case 0: return 0x6000 | x | kk;
+        case 1: return 0x7000 | x | kk;
+        case 2: return 0x8000 | x | y | alu8[rnd.below(sizeof(alu8))];
+        case 3: return 0xC000 | x | kk;
+        default: return 0xF000 | x | aluF[rnd.below(sizeof(aluF))];
+    }
+}
+
+static uint16_t randomSkip(Random& rnd)
+{
+    uint16_t x = rnd.below(16) << 8;
+    uint16_t y = rnd.below(16) << 4;
+    uint16_t kk = rnd.below(256);
+    switch (rnd.below(6)) {
+        case 0: return 0x3000 | x | kk;
+        case 1: return 0x4000 | x | kk;
+        case 2: return 0x5000 | x | y;
+        case 3: return 0x9000 | x | y;
+        case 4: return 0xE09E | x;
+        default: return 0xE0A1 | x;
+    }
+}
+
+// Builds a ROM out of small templates that can never fault: control flow only
+// lands on template starts or subroutines, a skip only ever skips a single
+// self-contained instruction, and memory writes stay inside the data area.
+// Jumps only go forward, so the one back-edge is the JP at the end of the
+// code and every pass runs to it instead of spinning in a tiny loop.
+static std::vector<uint8_t> generateRom(uint32_t seed)
+{
+    Random rnd;
+    rnd.state = seed * 2654435761u + 1;
+
+    std::vector<uint8_t> rom(DATA_END - CODE_START);
+    for (int a = DATA_START; a < DATA_END; a++)
+    {
+        rom[a - CODE_START] = rnd.next();
+    }
+
+    std::vector<uint16_t> subs;
+    int addr = SUB_START;
+    while (addr < SUB_END - 34)
+    {
+        subs.push_back(addr);
+        int n = rnd.below(16);
+        for (int i = 0; i < n; i++, addr += 2)
+        {
+            uint16_t op = randomAlu(rnd);
+            rom[addr - CODE_START] = op >> 8;
+            rom[addr - CODE_START + 1] = op & 0xFF;
+        }
+        rom[addr - CODE_START] = 0x00;
+        rom[addr - CODE_START + 1] = 0xEE;
+        addr += 2;
+    }
+
+    std::vector<uint16_t> code;
+    std::vector<uint16_t> starts;
+    std::vector<size_t> jumps;
+    std::vector<size_t> jump_from;
+    while (CODE_START + 2 * (code.size() + 4) < CODE_END - 2)
+    {
+        starts.push_back(CODE_START + 2 * code.size());
+        int kind = rnd.below(16);
+        if (kind < 6) {
+            code.push_back(randomAlu(rnd));
+        } else if (kind < 10) {
+            code.push_back(randomSkip(rnd));
+            int next = rnd.below(4);
+            if (next == 0) {
+                jumps.push_back(code.size());
+                jump_from.push_back(starts.size());
+                code.push_back(0x1000);
+            } else if (next == 1) {
+                code.push_back(0x2000 | subs[rnd.below(subs.size())]);
+            } else {
+                code.push_back(randomAlu(rnd));
+            }
+        } else if (kind == 10) {
+            code.push_back(0x2000 | subs[rnd.below(subs.size())]);
+        } else if (kind == 11) {
+            // Bnnn: V0 is loaded right before, nnn is fixed up with it
+            code.push_back(0x6000 | rnd.below(256));
+            jumps.push_back(code.size());
+            jump_from.push_back(starts.size());
+            code.push_back(0xB000);
+        } else if (kind == 12) {
+            int n = 1 + rnd.below(15);
+            code.push_back(0x6D00 | rnd.below(256));
+            code.push_back(0x6E00 | rnd.below(33 - n));
+            if (rnd.below(2)) {
+                code.push_back(0xA000 | (DATA_START + rnd.below(0x100)));
+            } else {
+                code.push_back(0xF029 | rnd.below(16) << 8);
+            }
+            code.push_back(0xDDE0 | n);
+        } else if (kind == 13) {
+            static const uint8_t memF[] = { 0x33, 0x55, 0x65 };
+            code.push_back(0xA000 | (DATA_START + rnd.below(0x100)));
+            if (rnd.below(2)) code.push_back(0xF01E | rnd.below(16) << 8);
+            code.push_back(0xF000 | rnd.below(16) << 8 | memF[rnd.below(sizeof(memF))]);
+        } else if (kind == 14) {
+            code.push_back(0xF00A | rnd.below(16) << 8);
+        } else {
+            code.push_back(0x00E0);
+        }
+    }
+    starts.push_back(CODE_START + 2 * code.size());
+    code.push_back(0x1000 | CODE_START);
+
+    for (size_t i = 0; i < jumps.size(); i++)
+    {
+        // short hops, so that a pass still runs most of the code
+        size_t first = jump_from[i];
+        size_t span = starts.size() - first < 8 ? starts.size() - first : 8;
+        uint16_t target = starts[first + rnd.below(span)];
+        uint16_t& op = code[jumps[i]];
+        if (op == 0xB000) {
+            op |= target - (code[jumps[i] - 1] & 0xFF);
+        } else {
+            op |= target;
+        }
+    }
+
+    for (size_t i = 0; i < code.size(); i++)
+    {
+        rom[2 * i] = code[i] >> 8;
+        rom[2 * i + 1] = code[i] & 0xFF;
+    }
+    return rom;
+}
+
+static std::vector<InputEvent> generateInput(uint32_t seed, long instructions)
+{
+    Random rnd;
+    rnd.state = seed * 2246822519u + 1;
+
+    std::vector<InputEvent> input;
+    for (long cycle = 0; cycle < instructions; cycle += 1 + rnd.below(2000))
+    {
+        InputEvent e;
+        e.cycle = cycle;
+        e.keys = rnd.below(3) ? 0 : 1 << rnd.below(16);
+        input.push_back(e);
+    }
+    return input;
+}
+
+// One "<cycle> <hex key mask>" per line, held from that cycle on
+static bool loadInput(const char* path, std::vector<InputEvent>& input)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        perror("fopen: ");
+        return false;
+    }
+    InputEvent e;
+    unsigned int keys;
+    while (fscanf(fp, "%ld %x", &e.cycle, &keys) == 2)
+    {
+        e.keys = keys;
+        input.push_back(e);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [options] <rom file> [input log]\n", name);
+    fprintf(stderr, "       %s [options] -r <rom count>\n", name);
+    fprintf(stderr, "  -e <engine>    candidate engine (default: frames)\n");
+    fprintf(stderr, "  -n <count>     instructions to run per ROM (default: 1000000)\n");
+    fprintf(stderr, "  -i <count>     instructions between state comparisons (default: 8)\n");
+    fprintf(stderr, "  -f <count>     instructions per timer tick (default: 8)\n");
+    fprintf(stderr, "  -r <count>     verify this many random ROMs\n");
+    fprintf(stderr, "  -s <seed>      first random ROM seed (default: 1)\n");
+    fprintf(stderr, "  -j <threads>   threads for random ROMs (default: all cores)\n");
+    fprintf(stderr, "The candidate runs batches of up to -i instructions, ticking the timers itself,\n");
+    fprintf(stderr, "and state is only compared between batches: a difference that is overwritten\n");
+    fprintf(stderr, "before the next comparison goes unnoticed. -i 1 compares after every\n");
+    fprintf(stderr, "instruction, but then never lets the candidate run a batch.\n");
+    fprintf(stderr, "Random ROMs running fewer than %d distinct PCs are reseeded.\n", MIN_COVERAGE);
+    fprintf(stderr, "engines:");
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+    {
+        fprintf(stderr, " %s", engines[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options opts;
+    opts.candidate = framesEngine;
+    opts.instructions = 1000000;
+    opts.interval = 8;
+    opts.cycles_per_frame = 8;
+    long roms = 0;
+    uint32_t first_seed = 1;
+    int threads = std::thread::hardware_concurrency();
+
+    int c;
+    while ((c = getopt(argc, argv, "e:n:i:f:r:s:j:")) != -1)
+    {
+        switch (c) {
+            case 'e':
+                opts.candidate = NULL;
+                for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+                {
+                    if (strcmp(optarg, engines[i].name) == 0) opts.candidate = engines[i].engine;
+                }
+                if (!opts.candidate) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n': opts.instructions = atol(optarg); break;
+            case 'i': opts.interval = atol(optarg); break;
+            case 'f': opts.cycles_per_frame = atoi(optarg); break;
+            case 'r': roms = atol(optarg); break;
+            case 's': first_seed = strtoul(optarg, NULL, 0); break;
+            case 'j': threads = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (opts.interval < 1) opts.interval = 1;
+    if (opts.cycles_per_frame < 1) opts.cycles_per_frame = 1;
+
+    if (roms == 0) {
+        if (argc - optind < 1 || argc - optind > 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::vector<InputEvent> input;
+        if (argc - optind == 2 && !loadInput(argv[optind+1], input)) return 1;
+
+        Chip8 start;
+        if (!start.load(std::string(argv[optind]))) {
+            fprintf(stderr, "Could not load %s\n", argv[optind]);
+            return 1;
+        }
+        Divergence div;
+        Step step = verify(start, opts, input, NULL, &div);
+        if (step == STEP_DIVERGED) {
+            printDivergence(div);
+            return 1;
+        }
+        if (step == STEP_FAULT) {
+            printf("%ld instructions verified, both stopped at unsupported opcode %04x (pc=%03x)\n",
+                   div.cycle, div.instr, div.pc);
+            return 0;
+        }
+        printf("%ld instructions verified\n", opts.instructions);
+        return 0;
+    }
+
+    std::atomic<long> next(0);
+    std::atomic<long> failures(0);
+    std::atomic<long> stalls(0);
+    std::atomic<long> unverified(0);
+    std::mutex print_lock;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.push_back(std::thread([&]() {
+            long i;
+            while ((i = next++) < roms)
+            {
+                uint32_t seed = first_seed + i;
+                for (int attempt = 0; attempt <= MAX_RESEEDS; attempt++)
+                {
+                    std::vector<uint8_t> rom = generateRom(seed);
+                    Chip8 start(seed);
+                    start.load(rom.data(), rom.size());
+                    Coverage cov;
+                    cov.from = opts.instructions / 2;
+                    cov.seen.assign(0x1000, false);
+                    cov.distinct = 0;
+                    Divergence div;
+                    Step step = verify(start, opts, generateInput(seed, opts.instructions), &cov, &div);
+                    if (step != STEP_OK) {
+                        failures++;
+                        std::lock_guard<std::mutex> lock(print_lock);
+                        printf("seed %u: ", seed);
+                        if (step == STEP_DIVERGED) {
+                            printDivergence(div);
+                        } else {
+                            printf("unsupported opcode %04x (pc=%03x) at instruction %ld\n", div.instr, div.pc, div.cycle);
+                        }
+                        break;
+                    }
+                    if (cov.distinct >= MIN_COVERAGE) break;
+                    if (attempt == MAX_RESEEDS) {
+                        unverified++;
+                        std::lock_guard<std::mutex> lock(print_lock);
+                        printf("seed %u: still stalled after %d reseeds, unverified\n", first_seed + (uint32_t)i, MAX_RESEEDS);
+                        break;
+                    }
+                    stalls++;
+                    seed += 0x9E3779B9u;
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+
+    printf("%ld/%ld random ROMs verified over %ld instructions each, %ld stalled ROMs reseeded, %ld unverified\n",
+           roms - failures.load() - unverified.load(), roms, opts.instructions, stalls.load(), unverified.load());
+    return failures > 0 || unverified > 0;
+}